@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_EMULATOR_PROTOCOLS_ASYNC_H
+#define SHAREMIND_EMULATOR_PROTOCOLS_ASYNC_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Detail.h"
+
+
+namespace sharemind {
+
+/**
+ * \brief A bounded pool of worker threads which runs protocol invocations in
+ *        the order of their operands.
+ *
+ * An invocation which writes to a vector runs after all earlier invocations
+ * which read or write it, and an invocation which reads a vector runs after
+ * the earlier invocation which wrote it. Invocations are queued to the
+ * workers only once these dependencies have finished, so waiting invocations
+ * do not occupy threads. Independent invocations run concurrently.
+ *
+ * Vectors are identified by address, and "earlier" means submitted earlier.
+ * If an invocation depends on one which failed, it is not run and fails too.
+ * A vector is forgotten once all invocations using it have finished, unless
+ * the last one writing it failed, so that later readers still fail.
+ */
+class __attribute__ ((visibility("internal"))) AsyncExecutor {
+
+public: /* Types: */
+
+    using Future = std::shared_future<bool>;
+
+    /** \brief An operand address and whether the invocation writes to it. */
+    using Operand = std::pair<const void *, bool>;
+
+private: /* Types: */
+
+    struct Task {
+        std::function<bool ()> function;
+        std::promise<bool> promise;
+        std::size_t pendingDependencies = 0u;
+        bool dependencyFailed = false;
+        bool done = false;
+        bool result = false;
+        std::vector<std::shared_ptr<Task>> dependents;
+        std::vector<const void *> operands;
+    };
+
+    using TaskPtr = std::shared_ptr<Task>;
+
+    struct Dependencies {
+        TaskPtr lastWriter;
+        std::vector<TaskPtr> readers;
+    };
+
+public: /* Methods: */
+
+    explicit AsyncExecutor(
+            const unsigned threads = std::thread::hardware_concurrency())
+    {
+        for (unsigned i = 0u; i < std::max(threads, 1u); ++i)
+            m_workers.emplace_back(&AsyncExecutor::work, this);
+    }
+
+    AsyncExecutor(const AsyncExecutor &) = delete;
+    AsyncExecutor & operator=(const AsyncExecutor &) = delete;
+
+    ~AsyncExecutor() {
+        wait();
+        {
+            std::lock_guard<std::mutex> const guard(m_mutex);
+            m_stopping = true;
+        }
+
+        m_readyCondition.notify_all();
+        for (std::thread & worker : m_workers)
+            worker.join();
+    }
+
+    /** \brief Schedules a function which reads and writes the operands. */
+    Future submit(std::function<bool ()> function,
+                  const std::vector<Operand> & operands)
+    {
+        const TaskPtr task(std::make_shared<Task>());
+        task->function = std::move(function);
+        for (const Operand & operand : operands)
+            task->operands.push_back(operand.first);
+        const Future future(task->promise.get_future().share());
+
+        std::lock_guard<std::mutex> const guard(m_mutex);
+        for (const Operand & operand : operands) {
+            Dependencies & d = m_operands[operand.first];
+            addDependency(task, d.lastWriter);
+            if (operand.second) {
+                for (const TaskPtr & reader : d.readers)
+                    addDependency(task, reader);
+            }
+        }
+
+        for (const Operand & operand : operands) {
+            Dependencies & d = m_operands[operand.first];
+            if (operand.second) {
+                d.lastWriter = task;
+                d.readers.clear();
+            } else {
+                d.readers.erase(
+                        std::remove_if(d.readers.begin(),
+                                       d.readers.end(),
+                                       [](const TaskPtr & t)
+                                       { return t->done; }),
+                        d.readers.end());
+                d.readers.push_back(task);
+            }
+        }
+
+        ++m_unfinished;
+        if (task->pendingDependencies == 0u) {
+            m_ready.push_back(task);
+            m_readyCondition.notify_one();
+        }
+
+        return future;
+    }
+
+    /** \brief Blocks until all submitted invocations have finished. */
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idleCondition.wait(lock, [this]() { return m_unfinished == 0u; });
+        m_operands.clear();
+    }
+
+private: /* Methods: */
+
+    /* Called with the mutex held. */
+    static void addDependency(const TaskPtr & task,
+                              const TaskPtr & dependency)
+    {
+        if (!dependency || dependency == task)
+            return;
+
+        if (dependency->done) {
+            if (!dependency->result)
+                task->dependencyFailed = true;
+            return;
+        }
+
+        for (const TaskPtr & dependent : dependency->dependents)
+            if (dependent == task)
+                return;
+
+        dependency->dependents.push_back(task);
+        ++task->pendingDependencies;
+    }
+
+    /* Called with the mutex held once the task is done. */
+    void forgetOperands(const Task & task) {
+        for (const void * const address : task.operands) {
+            const auto it = m_operands.find(address);
+            if (it == m_operands.end())
+                continue;
+
+            Dependencies & d = it->second;
+            d.readers.erase(
+                    std::remove_if(d.readers.begin(),
+                                   d.readers.end(),
+                                   [](const TaskPtr & t) { return t->done; }),
+                    d.readers.end());
+            if (d.readers.empty()
+                && (!d.lastWriter
+                    || (d.lastWriter->done && d.lastWriter->result)))
+                m_operands.erase(it);
+        }
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_readyCondition.wait(
+                    lock,
+                    [this]() { return m_stopping || !m_ready.empty(); });
+            if (m_ready.empty())
+                return;
+
+            const TaskPtr task(std::move(m_ready.front()));
+            m_ready.pop_front();
+
+            lock.unlock();
+            bool result = false;
+            if (!task->dependencyFailed) {
+                try {
+                    result = task->function();
+                } catch (...) {
+                    result = false;
+                }
+            }
+
+            task->function = nullptr;
+            task->promise.set_value(result);
+            lock.lock();
+
+            task->done = true;
+            task->result = result;
+            for (const TaskPtr & dependent : task->dependents) {
+                if (!result)
+                    dependent->dependencyFailed = true;
+
+                if (--dependent->pendingDependencies == 0u)
+                    m_ready.push_back(dependent);
+            }
+
+            task->dependents.clear();
+            forgetOperands(*task);
+            if (!m_ready.empty())
+                m_readyCondition.notify_all();
+
+            if (--m_unfinished == 0u)
+                m_idleCondition.notify_all();
+        }
+    }
+
+private: /* Fields: */
+
+    std::mutex m_mutex;
+    std::condition_variable m_readyCondition;
+    std::condition_variable m_idleCondition;
+    std::deque<TaskPtr> m_ready;
+    std::map<const void *, Dependencies> m_operands;
+    std::size_t m_unfinished = 0u;
+    bool m_stopping = false;
+    std::vector<std::thread> m_workers;
+
+}; /* class AsyncExecutor { */
+
+/**
+ * \brief Runs the invocations of a protocol on an AsyncExecutor.
+ *
+ * AsyncProtocol<P>::invoke() takes the same arguments as P::invoke(), but
+ * returns immediately with a future for the result. An operand is treated as
+ * read if the matching P::invoke() parameter is a const reference and as
+ * written otherwise, regardless of the constness of the caller's object.
+ * Protocols sharing an executor are ordered with respect to each other.
+ *
+ * Vector operands passed as lvalues are kept by reference, hence they must
+ * stay alive and must not be accessed by the caller until the corresponding
+ * future is ready. Operands passed as rvalues (e.g. a temporary
+ * ConstantShareVec) are moved into the invocation and, as nothing else can
+ * refer to them, are not ordered. Other arguments (e.g. public parameters)
+ * are copied.
+ *
+ * The wrapped protocol is shared between concurrent invocations, so it must
+ * not have mutable state (e.g. RandomizeProtocol uses the RNG of the PDPI).
+ * Destroying an AsyncProtocol waits for all invocations on its executor.
+ */
+template <typename Protocol>
+class __attribute__ ((visibility("internal"))) AsyncProtocol {
+
+private: /* Types: */
+
+    template <typename Arg>
+    using IsSharedOperand = std::integral_constant<
+            bool,
+            protocols_detail::IsOperand<Arg>::value
+            && std::is_lvalue_reference<Arg>::value>;
+
+    template <typename Arg>
+    using Stored = typename std::conditional<
+            IsSharedOperand<Arg>::value,
+            std::reference_wrapper<typename std::remove_reference<Arg>::type>,
+            typename std::decay<Arg>::type>::type;
+
+public: /* Methods: */
+
+    template <typename ... Args>
+    AsyncProtocol(AsyncExecutor & executor, Args && ... args)
+        : m_executor(executor)
+        , m_protocol(std::forward<Args>(args)...)
+    { }
+
+    AsyncProtocol(const AsyncProtocol &) = delete;
+    AsyncProtocol & operator=(const AsyncProtocol &) = delete;
+
+    /* The pending invocations refer to m_protocol. */
+    ~AsyncProtocol() { m_executor.wait(); }
+
+    template <typename ... Args>
+    AsyncExecutor::Future invoke(Args && ... args) {
+        using Indices = typename protocols_detail::MakeIndexSequence<
+                sizeof...(Args)>::type;
+
+        std::vector<AsyncExecutor::Operand> operands;
+        collectOperands<Args...>(operands, Indices(), args...);
+
+        /* Shared, as moved operands need not be copyable: */
+        using Tuple = std::tuple<Stored<Args>...>;
+        const std::shared_ptr<Tuple> argsTuple(
+                std::make_shared<Tuple>(std::forward<Args>(args)...));
+        Protocol & protocol = m_protocol;
+        return m_executor.submit(
+                    [&protocol, argsTuple]() -> bool
+                    { return apply(protocol, *argsTuple, Indices()); },
+                    operands);
+    }
+
+    /** \brief Blocks until all invocations on the executor have finished. */
+    void wait() { m_executor.wait(); }
+
+private: /* Methods: */
+
+    template <typename T>
+    static T & unwrap(std::reference_wrapper<T> & arg) noexcept
+    { return arg.get(); }
+
+    template <typename T>
+    static T & unwrap(T & arg) noexcept { return arg; }
+
+    template <typename Tuple, std::size_t ... Is>
+    static bool apply(Protocol & protocol,
+                      Tuple & args,
+                      protocols_detail::IndexSequence<Is...>)
+    {
+        return protocol.invoke(unwrap(std::get<Is>(args))...);
+    }
+
+    template <typename ... Args, std::size_t ... Is>
+    static void collectOperands(std::vector<AsyncExecutor::Operand> & operands,
+                                protocols_detail::IndexSequence<Is...>,
+                                Args & ... args)
+    {
+        const bool expand[] = {
+            false,
+            (collectOperand(
+                 operands,
+                 args,
+                 IsSharedOperand<Args>(),
+                 !protocols_detail::IsInputOperand<Protocol, Is, Args...>
+                    ::value),
+             false)...
+        };
+        (void) expand;
+    }
+
+    template <typename Arg>
+    static void collectOperand(std::vector<AsyncExecutor::Operand> &,
+                               const Arg &,
+                               std::false_type,
+                               bool)
+    { }
+
+    template <typename Arg>
+    static void collectOperand(std::vector<AsyncExecutor::Operand> & operands,
+                               const Arg & arg,
+                               std::true_type,
+                               const bool written)
+    {
+        operands.emplace_back(static_cast<const void *>(&arg), written);
+    }
+
+private: /* Fields: */
+
+    AsyncExecutor & m_executor;
+    Protocol m_protocol;
+
+}; /* class AsyncProtocol { */
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_EMULATOR_PROTOCOLS_ASYNC_H */
@@ -20,10 +20,13 @@
 #ifndef SHAREMIND_EMULATOR_PROTOCOLS_BINARY_H
 #define SHAREMIND_EMULATOR_PROTOCOLS_BINARY_H
 
+#include <climits>
 #include <type_traits>
 #include <sharemind/ShareVector.h>
 #include <sharemind/ValueTraits.h>
 #include <sharemind/VmVector.h>
+#include "ConstantShareVector.h"
+#include "Detail.h"
 
 
 namespace sharemind {
@@ -49,6 +52,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] + value;
+
+        return true;
+    }
+
 }; /* class AdditionProtocol { */
 
 template <typename PDPI>
@@ -72,6 +91,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] & value;
+
+        return true;
+    }
+
 }; /* class BitwiseAndProtocol { */
 
 template <typename PDPI>
@@ -95,6 +130,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] | value;
+
+        return true;
+    }
+
 }; /* class BitwiseOrProtocol { */
 
 template <typename PDPI>
@@ -118,6 +169,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] ^ value;
+
+        return true;
+    }
+
 }; /* class BitwiseXorProtocol { */
 
 template <typename PDPI>
@@ -166,6 +233,25 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        if (param1.size() != 0u && value == 0)
+            return false;
+
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] / value;
+
+        return true;
+    }
+
 }; /* class DivisionProtocol { */
 
 template <typename PDPI>
@@ -189,8 +275,122 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<U> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] == value;
+
+        return true;
+    }
+
 }; /* class EqualityProtocol { */
 
+/**
+ * \brief Fixed-point dot products of equal-length segments.
+ *
+ * Like SumProtocol, the parameters are split into result.size() segments of
+ * equal length. The products are accumulated at double width and the sum is
+ * truncated by the given number of fractional bits once per segment.
+ */
+template <typename PDPI>
+class __attribute__ ((visibility("internal"))) FixedPointDotProductProtocol {
+public: /* Methods: */
+
+    FixedPointDotProductProtocol(PDPI & pdpi) { (void) pdpi; }
+
+    template <typename T>
+    typename std::enable_if<
+            is_any_value_tag<T>::value
+            && protocols_detail::HasIntegerElements<ShareVec<T>>::value,
+            bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ShareVec<T> & param2,
+           const size_t fractional_bits,
+           ShareVec<T> & result)
+    {
+        using S = typename std::decay<decltype(result[0u])>::type;
+        using Arithmetic = protocols_detail::FixedPointArithmetic<S>;
+
+        const size_t param_size = param1.size();
+        const size_t result_size = result.size();
+        if (param_size != param2.size() || result_size == 0u)
+            return false;
+
+        if (param_size % result_size != 0u)
+            return false;
+
+        if (fractional_bits >= sizeof(S) * CHAR_BIT)
+            return false;
+
+        const unsigned f = static_cast<unsigned>(fractional_bits);
+        const size_t subarr_len = param_size / result_size;
+        for (size_t i = 0u; i < result_size; ++i) {
+            typename Arithmetic::UnsignedWide sum = 0u;
+            const size_t end = (i + 1u) * subarr_len;
+            for (size_t j = i * subarr_len; j < end; ++j)
+                sum += Arithmetic::product(param1[j], param2[j]);
+
+            result[i] = Arithmetic::truncate(sum, f);
+        }
+
+        return true;
+    }
+
+}; /* class FixedPointDotProductProtocol { */
+
+/**
+ * \brief Element-wise fixed-point multiplication.
+ *
+ * Each product is computed at double width and truncated by the given number
+ * of fractional bits, so it replaces MultiplicationProtocol followed by
+ * DivisionProtocol by 2^fractional_bits without losing the high bits of the
+ * product.
+ */
+template <typename PDPI>
+class __attribute__ ((visibility("internal")))
+        FixedPointMultiplicationProtocol
+{
+public: /* Methods: */
+
+    FixedPointMultiplicationProtocol(PDPI & pdpi) { (void) pdpi; }
+
+    template <typename T>
+    typename std::enable_if<
+            is_any_value_tag<T>::value
+            && protocols_detail::HasIntegerElements<ShareVec<T>>::value,
+            bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ShareVec<T> & param2,
+           const size_t fractional_bits,
+           ShareVec<T> & result)
+    {
+        using S = typename std::decay<decltype(result[0u])>::type;
+        using Arithmetic = protocols_detail::FixedPointArithmetic<S>;
+
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        if (fractional_bits >= sizeof(S) * CHAR_BIT)
+            return false;
+
+        const unsigned f = static_cast<unsigned>(fractional_bits);
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = Arithmetic::truncate(
+                            Arithmetic::product(param1[i], param2[i]), f);
+
+        return true;
+    }
+
+}; /* class FixedPointMultiplicationProtocol { */
+
 template <typename PDPI>
 class __attribute__ ((visibility("internal"))) GreaterThanProtocol {
 public: /* Methods: */
@@ -212,6 +412,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<U> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] > value;
+
+        return true;
+    }
+
 }; /* class GreaterThanProtocol { */
 
 template <typename PDPI>
@@ -235,6 +451,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<U> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] >= value;
+
+        return true;
+    }
+
 }; /* class GreaterThanOrEqualProtocol { */
 
 template <typename PDPI>
@@ -258,6 +490,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<U> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] < value;
+
+        return true;
+    }
+
 }; /* class LessThanProtocol { */
 
 template <typename PDPI>
@@ -281,6 +529,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<U> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] <= value;
+
+        return true;
+    }
+
 }; /* class LessThanOrEqualProtocol { */
 
 template <typename PDPI>
@@ -365,6 +629,22 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] * value;
+
+        return true;
+    }
+
 }; /* class MultiplicationProtocol { */
 
 template <typename PDPI>
@@ -413,6 +693,25 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        if (param1.size() != 0u && value == 0)
+            return false;
+
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] % value;
+
+        return true;
+    }
+
 }; /* class RemainderProtocol { */
 
 template <typename PDPI>
@@ -436,6 +735,38 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ConstantShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param2.value();
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = param1[i] - value;
+
+        return true;
+    }
+
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ConstantShareVec<T> & param1,
+           const ShareVec<T> & param2,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() || param1.size() != result.size())
+            return false;
+
+        const auto value = param1.value();
+        for (size_t i = 0u; i < param2.size(); ++i)
+            result[i] = value - param2[i];
+
+        return true;
+    }
+
 }; /* class SubtractionProtocol { */
 
 } /* namespace sharemind { */
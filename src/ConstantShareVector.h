@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_EMULATOR_PROTOCOLS_CONSTANTSHAREVECTOR_H
+#define SHAREMIND_EMULATOR_PROTOCOLS_CONSTANTSHAREVECTOR_H
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <sharemind/ShareVector.h>
+#include <sharemind/ValueTraits.h>
+
+
+namespace sharemind {
+
+/**
+ * \brief A share vector with all elements equal, e.g. an all-zero mask or a
+ *        broadcast flag.
+ *
+ * Only the value and the size are stored. The protocols accept it in place of
+ * a ShareVec operand where this saves work; elsewhere it has to be expanded
+ * with materialize().
+ */
+template <typename T>
+class __attribute__ ((visibility("internal"))) ConstantShareVec {
+
+    static_assert(is_any_value_tag<T>::value, "T must be a value tag!");
+
+public: /* Types: */
+
+    using share_type = typename std::decay<
+            decltype(std::declval<const ShareVec<T> &>()[0u])>::type;
+
+public: /* Methods: */
+
+    ConstantShareVec(const size_t size, const share_type value)
+        : m_size(size)
+        , m_value(value)
+    { }
+
+    size_t size() const noexcept { return m_size; }
+
+    share_type value() const noexcept { return m_value; }
+
+    share_type operator[](const size_t i) const noexcept {
+        (void) i;
+        return m_value;
+    }
+
+    /** \brief Writes the value to every element of a vector of equal size. */
+    bool materialize(ShareVec<T> & result) const {
+        if (result.size() != m_size)
+            return false;
+
+        for (size_t i = 0u; i < m_size; ++i)
+            result[i] = m_value;
+
+        return true;
+    }
+
+private: /* Fields: */
+
+    const size_t m_size;
+    const share_type m_value;
+
+}; /* class ConstantShareVec { */
+
+namespace protocols_detail {
+
+/* Integer arithmetic on shares wraps around, hence products of signed values
+   are computed on the corresponding unsigned type. */
+template <typename S, bool = std::is_integral<S>::value
+                             && !std::is_same<S, bool>::value>
+struct WrappingArithmetic {
+
+    static S multiply(const S a, const S b) noexcept { return a * b; }
+
+};
+
+template <typename S>
+struct WrappingArithmetic<S, true> {
+
+    /* At least unsigned int, as narrower types are promoted to int. */
+    using Unsigned = typename std::common_type<
+            typename std::make_unsigned<S>::type,
+            unsigned>::type;
+
+    static S multiply(const S a, const S b) noexcept {
+        return static_cast<S>(static_cast<Unsigned>(a)
+                              * static_cast<Unsigned>(b));
+    }
+
+};
+
+/** \returns the sum of n copies of the given value. */
+template <typename S>
+S repeatedSum(const S value, const size_t n) noexcept {
+    return WrappingArithmetic<S>::multiply(value, static_cast<S>(n));
+}
+
+/** \returns the product of n copies of the given value. */
+template <typename S>
+S repeatedProduct(S value, size_t n) noexcept {
+    S result = 1;
+    for (; n; n >>= 1u) {
+        if (n & 1u)
+            result = WrappingArithmetic<S>::multiply(result, value);
+        value = WrappingArithmetic<S>::multiply(value, value);
+    }
+
+    return result;
+}
+
+} /* namespace protocols_detail { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_EMULATOR_PROTOCOLS_CONSTANTSHAREVECTOR_H */
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_EMULATOR_PROTOCOLS_DETAIL_H
+#define SHAREMIND_EMULATOR_PROTOCOLS_DETAIL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace sharemind {
+namespace protocols_detail {
+
+template <std::size_t ... Is>
+struct IndexSequence {};
+
+template <std::size_t N, std::size_t ... Is>
+struct MakeIndexSequence: MakeIndexSequence<N - 1u, N - 1u, Is...> {};
+
+template <std::size_t ... Is>
+struct MakeIndexSequence<0u, Is...> { using type = IndexSequence<Is...>; };
+
+/* Operands are the arguments which have a size(), i.e. share and VM vectors.
+   Scalar arguments (e.g. public parameters) are not operands. */
+template <typename T>
+struct IsOperandHelper {
+
+    template <typename U>
+    static auto test(int)
+            -> decltype(std::declval<U &>().size(), std::true_type());
+
+    template <typename>
+    static std::false_type test(...);
+
+    using type = decltype(test<typename std::remove_reference<T>::type>(0));
+
+};
+
+template <typename T>
+struct IsOperand: IsOperandHelper<T>::type {};
+
+template <typename Arg, bool asConst>
+using ArgumentAs = typename std::conditional<
+        asConst,
+        const typename std::decay<Arg>::type &,
+        typename std::remove_reference<Arg>::type &>::type;
+
+template <typename Protocol,
+          std::size_t I,
+          typename Indices,
+          typename ... Args>
+struct IsInputOperandHelper;
+
+template <typename Protocol,
+          std::size_t I,
+          std::size_t ... Is,
+          typename ... Args>
+struct IsInputOperandHelper<Protocol, I, IndexSequence<Is...>, Args...> {
+
+    template <typename P>
+    static auto test(int)
+            -> decltype(std::declval<P &>().invoke(
+                            std::declval<ArgumentAs<Args, Is == I>>()...),
+                        std::true_type());
+
+    template <typename>
+    static std::false_type test(...);
+
+    using type = decltype(test<Protocol>(0));
+
+};
+
+/**
+ * \brief Whether the I-th argument of Protocol::invoke(Args...) is only read.
+ *
+ * The protocols take their parameters by const reference and their results by
+ * non-const reference, so an argument is an input exactly when the call still
+ * resolves with that argument made const.
+ */
+template <typename Protocol, std::size_t I, typename ... Args>
+struct IsInputOperand
+        : IsInputOperandHelper<
+                Protocol,
+                I,
+                typename MakeIndexSequence<sizeof...(Args)>::type,
+                Args...>::type
+{};
+
+/**
+ * \brief Checks that public offsets describe consecutive segments covering a
+ *        vector, i.e. that there is one more offset than there are segments,
+ *        the first offset is zero, the offsets are nondecreasing (increasing
+ *        unless empty segments are allowed) and the last offset equals the
+ *        size of the vector.
+ */
+template <typename Offsets>
+bool validSegmentOffsets(const Offsets & offsets,
+                         const std::size_t size,
+                         const std::size_t segments,
+                         const bool allowEmpty = true)
+{
+    using O = typename std::decay<decltype(offsets[0u])>::type;
+    static_assert(std::is_integral<O>::value
+                  && std::is_unsigned<O>::value
+                  && !std::is_same<O, bool>::value,
+                  "Segment offsets must be of an unsigned integer type!");
+
+    if (offsets.size() != segments + 1u || offsets[0u] != 0u)
+        return false;
+
+    for (std::size_t i = 0u; i < segments; ++i) {
+        if (offsets[i] > offsets[i + 1u]
+            || (!allowEmpty && offsets[i] == offsets[i + 1u]))
+            return false;
+    }
+
+    return offsets[segments] == size;
+}
+
+/* The number of elements below which segments are reduced on the calling
+   thread only, as starting a thread costs more than reducing them. */
+constexpr std::size_t MinElementsPerThread = std::size_t(1u) << 16u;
+
+/**
+ * \brief Calls f(first, last) for consecutive ranges [first, last) of the
+ *        given valid segments, balanced by element count, concurrently.
+ *
+ * The ranges are cut where offsets reach multiples of the element count
+ * divided by the number of threads, found with a binary search, so each
+ * range has about as many elements as the others unless a single segment is
+ * larger. f is called from several threads and must only write the results
+ * of its own range. The first range is run on the calling thread, as are the
+ * ranges whose thread could not be started.
+ */
+template <typename Offsets, typename F>
+void forEachSegmentRange(const Offsets & offsets,
+                         const std::size_t segments,
+                         F f)
+{
+    const std::size_t elements = segments ? offsets[segments] : 0u;
+    const std::size_t threads = std::min<std::size_t>(
+            std::min<std::size_t>(std::thread::hardware_concurrency(),
+                                  elements / MinElementsPerThread),
+            segments);
+    if (threads <= 1u) {
+        f(std::size_t(0u), segments);
+        return;
+    }
+
+    /* The first segment which begins at or after the given element: */
+    const auto cut = [&offsets, segments](const std::size_t element) {
+        std::size_t low = 0u;
+        std::size_t high = segments;
+        while (low < high) {
+            const std::size_t middle = low + (high - low) / 2u;
+            if (offsets[middle] < element) {
+                low = middle + 1u;
+            } else {
+                high = middle;
+            }
+        }
+
+        return low;
+    };
+
+    const std::size_t step = elements / threads;
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1u);
+    std::size_t first = cut(step);
+    const std::size_t firstEnd = first;
+    for (std::size_t t = 1u; t < threads; ++t) {
+        const std::size_t last =
+                t + 1u == threads ? segments : cut(step * (t + 1u));
+        if (first < last) {
+            try {
+                workers.emplace_back(f, first, last);
+            } catch (const std::system_error &) {
+                f(first, last);
+            }
+        }
+
+        first = last;
+    }
+
+    f(std::size_t(0u), firstEnd);
+    for (std::thread & worker : workers)
+        worker.join();
+}
+
+template <typename Vector>
+using ElementType = typename std::decay<
+        decltype(std::declval<const Vector &>()[0u])>::type;
+
+/* Whether the elements of a vector are integers other than bool. */
+template <typename Vector>
+struct HasIntegerElements
+        : std::integral_constant<
+                bool,
+                std::is_integral<ElementType<Vector>>::value
+                && !std::is_same<ElementType<Vector>, bool>::value>
+{};
+
+__extension__ typedef __int128 Int128;
+__extension__ typedef unsigned __int128 UnsignedInt128;
+
+/**
+ * \brief Fixed-point arithmetic on integer shares with a double-width
+ *        intermediate, so that products do not overflow before they are
+ *        truncated.
+ *
+ * Truncation rounds toward zero like DivisionProtocol, so that dividing a
+ * product by 2^f with DivisionProtocol gives the same result whenever the
+ * product fits the share type, e.g. -3 with one fractional bit truncates to
+ * -1. Results wrap around to the share type.
+ */
+template <typename S,
+          std::size_t = sizeof(S),
+          bool = std::is_signed<S>::value>
+struct FixedPointArithmetic;
+
+template <typename S, typename Wide_, typename UnsignedWide_>
+struct FixedPointArithmeticBase {
+
+    using Wide = Wide_;
+    using UnsignedWide = UnsignedWide_;
+
+    /* Unsigned arithmetic wraps around instead of overflowing. */
+    static UnsignedWide product(const S a, const S b) noexcept {
+        return static_cast<UnsignedWide>(static_cast<Wide>(a))
+               * static_cast<UnsignedWide>(static_cast<Wide>(b));
+    }
+
+    static S add(const S a, const S b) noexcept {
+        const UnsignedWide sum = static_cast<UnsignedWide>(static_cast<Wide>(a))
+                                 + static_cast<UnsignedWide>(
+                                       static_cast<Wide>(b));
+        return static_cast<S>(sum);
+    }
+
+    static S truncate(const UnsignedWide a, const unsigned fractionalBits)
+            noexcept
+    {
+        return static_cast<S>(shift(static_cast<Wide>(a),
+                                    fractionalBits,
+                                    std::is_signed<S>()));
+    }
+
+private: /* Methods: */
+
+    static Wide shift(const Wide a,
+                      const unsigned fractionalBits,
+                      std::false_type) noexcept
+    { return a >> fractionalBits; }
+
+    /* Negative values are biased, as the shift alone rounds them down. */
+    static Wide shift(const Wide a,
+                      const unsigned fractionalBits,
+                      std::true_type) noexcept
+    {
+        const Wide bias = a < 0
+                          ? (static_cast<Wide>(1) << fractionalBits) - 1
+                          : 0;
+        return (a + bias) >> fractionalBits;
+    }
+
+};
+
+template <typename S, std::size_t size>
+struct FixedPointArithmetic<S, size, true>
+        : FixedPointArithmeticBase<S, int64_t, uint64_t>
+{ static_assert(size <= 4u, "Unsupported share type!"); };
+
+template <typename S, std::size_t size>
+struct FixedPointArithmetic<S, size, false>
+        : FixedPointArithmeticBase<S, uint64_t, uint64_t>
+{ static_assert(size <= 4u, "Unsupported share type!"); };
+
+template <typename S>
+struct FixedPointArithmetic<S, 8u, true>
+        : FixedPointArithmeticBase<S, Int128, UnsignedInt128>
+{};
+
+template <typename S>
+struct FixedPointArithmetic<S, 8u, false>
+        : FixedPointArithmeticBase<S, UnsignedInt128, UnsignedInt128>
+{};
+
+} /* namespace protocols_detail { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_EMULATOR_PROTOCOLS_DETAIL_H */
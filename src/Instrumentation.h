@@ -0,0 +1,513 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION_H
+#define SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION_H
+
+#include <utility>
+
+#ifdef SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+#include "Detail.h"
+
+#ifndef SHAREMIND_EMULATOR_PROTOCOLS_TRACE_BUFFER_SIZE
+#define SHAREMIND_EMULATOR_PROTOCOLS_TRACE_BUFFER_SIZE 65536u
+#endif
+#endif /* SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION */
+
+
+namespace sharemind {
+
+#ifdef SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION
+namespace instrumentation {
+
+/**
+ * \brief Log-linear (HDR-style) histogram of nanosecond latencies.
+ *
+ * Every power of two is split into eight linear sub-buckets, giving a
+ * relative error of at most 12.5% over the whole 64-bit range. Recording is
+ * lock-free.
+ */
+class __attribute__ ((visibility("internal"))) Histogram {
+
+public: /* Constants: */
+
+    static constexpr unsigned SubBucketBits = 3u;
+    static constexpr unsigned SubBuckets = 1u << SubBucketBits;
+    static constexpr unsigned Buckets =
+            (64u - SubBucketBits + 1u) * SubBuckets;
+
+public: /* Methods: */
+
+    Histogram() {
+        for (auto & bucket : m_buckets)
+            bucket.store(0u, std::memory_order_relaxed);
+    }
+
+    void record(const uint64_t value) noexcept {
+        m_buckets[bucketOf(value)].fetch_add(1u, std::memory_order_relaxed);
+        m_count.fetch_add(1u, std::memory_order_relaxed);
+
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value > max
+               && !m_max.compare_exchange_weak(max,
+                                               value,
+                                               std::memory_order_relaxed))
+        { }
+    }
+
+    uint64_t count() const noexcept
+    { return m_count.load(std::memory_order_relaxed); }
+
+    uint64_t max() const noexcept
+    { return m_max.load(std::memory_order_relaxed); }
+
+    /** \returns an upper bound of the given quantile (0.0 to 1.0). */
+    uint64_t quantile(const double q) const noexcept {
+        const uint64_t total = count();
+        if (total == 0u)
+            return 0u;
+
+        const uint64_t rank =
+                std::max<uint64_t>(1u, static_cast<uint64_t>(q * total + 0.5));
+        uint64_t seen = 0u;
+        for (unsigned i = 0u; i < Buckets; ++i) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return std::min(max(), upperBoundOf(i));
+        }
+
+        return max();
+    }
+
+private: /* Methods: */
+
+    static unsigned bucketOf(const uint64_t value) noexcept {
+        if (value < SubBuckets)
+            return static_cast<unsigned>(value);
+
+        const unsigned msb =
+                63u - static_cast<unsigned>(__builtin_clzll(value));
+        const unsigned sub = static_cast<unsigned>(
+                (value >> (msb - SubBucketBits)) & (SubBuckets - 1u));
+        return (msb - SubBucketBits + 1u) * SubBuckets + sub;
+    }
+
+    static uint64_t upperBoundOf(const unsigned bucket) noexcept {
+        if (bucket < SubBuckets)
+            return bucket;
+
+        const unsigned msb = bucket / SubBuckets + SubBucketBits - 1u;
+        const uint64_t sub = bucket % SubBuckets;
+        const unsigned shift = msb - SubBucketBits;
+        return ((SubBuckets + sub + 1u) << shift) - 1u;
+    }
+
+private: /* Fields: */
+
+    std::atomic<uint64_t> m_buckets[Buckets];
+    std::atomic<uint64_t> m_count{0u};
+    std::atomic<uint64_t> m_max{0u};
+
+}; /* class Histogram { */
+
+/** \brief Statistics of a single protocol and operand type. */
+struct __attribute__ ((visibility("internal"))) Site {
+
+    Site(std::string protocol_, std::string valueType_)
+        : protocol(std::move(protocol_))
+        , valueType(std::move(valueType_))
+    { }
+
+    const std::string protocol;
+    const std::string valueType;
+    Histogram latency;
+    std::atomic<uint64_t> elements{0u};
+
+}; /* struct Site { */
+
+struct __attribute__ ((visibility("internal"))) Event {
+    const Site * site;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t elements;
+};
+
+/**
+ * \brief Trace events of a single thread.
+ *
+ * Only the owning thread appends to the buffer, and publishes every event by
+ * a release store of the size, hence exporting may run concurrently with
+ * recording without any locks. Events which do not fit are counted and
+ * dropped. When its thread exits, the buffer is handed over to the next new
+ * thread, so short-lived threads share a track and do not each keep a buffer.
+ */
+class __attribute__ ((visibility("internal"))) ThreadBuffer {
+
+public: /* Methods: */
+
+    explicit ThreadBuffer(const unsigned threadId)
+        : m_threadId(threadId)
+        , m_events(new Event[SHAREMIND_EMULATOR_PROTOCOLS_TRACE_BUFFER_SIZE])
+    { }
+
+    void push(const Event & event) noexcept {
+        const size_t size = m_size.load(std::memory_order_relaxed);
+        if (size == SHAREMIND_EMULATOR_PROTOCOLS_TRACE_BUFFER_SIZE) {
+            m_dropped.fetch_add(1u, std::memory_order_relaxed);
+            return;
+        }
+
+        m_events[size] = event;
+        m_size.store(size + 1u, std::memory_order_release);
+    }
+
+    unsigned threadId() const noexcept { return m_threadId; }
+
+    size_t size() const noexcept
+    { return m_size.load(std::memory_order_acquire); }
+
+    const Event & operator[](const size_t i) const noexcept
+    { return m_events[i]; }
+
+    uint64_t dropped() const noexcept
+    { return m_dropped.load(std::memory_order_relaxed); }
+
+    /* Called by the registry with its mutex held. */
+    bool acquire() noexcept {
+        if (m_owned.load(std::memory_order_acquire))
+            return false;
+
+        m_owned.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    void release() noexcept { m_owned.store(false, std::memory_order_release); }
+
+private: /* Fields: */
+
+    const unsigned m_threadId;
+    std::atomic<bool> m_owned{true};
+    std::unique_ptr<Event[]> m_events;
+    std::atomic<size_t> m_size{0u};
+    std::atomic<uint64_t> m_dropped{0u};
+
+}; /* class ThreadBuffer { */
+
+/**
+ * \brief Process-wide registry of the instrumentation data.
+ *
+ * Recording is disabled by default and is switched on with setEnabled(). The
+ * registry mutex is only taken the first time a thread records an event and
+ * the first time a thread meets a new protocol and operand type pair.
+ */
+class __attribute__ ((visibility("internal"))) Registry {
+
+public: /* Methods: */
+
+    static Registry & instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    bool enabled() const noexcept
+    { return m_enabled.load(std::memory_order_relaxed); }
+
+    void setEnabled(const bool enabled) noexcept
+    { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+    uint64_t now() const noexcept {
+        return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - m_epoch).count());
+    }
+
+    Site & site(const char * const protocol, const std::type_info & valueType) {
+        using Key = std::pair<const void *, const void *>;
+        thread_local std::map<Key, Site *> cache;
+
+        const Key key(protocol, &valueType);
+        const auto it = cache.find(key);
+        if (it != cache.end())
+            return *it->second;
+
+        std::string typeName(demangle(valueType));
+        std::lock_guard<std::mutex> const guard(m_mutex);
+        Site * s = nullptr;
+        for (Site & existing : m_sites) {
+            if (existing.protocol == protocol
+                && existing.valueType == typeName)
+            {
+                s = &existing;
+                break;
+            }
+        }
+
+        if (!s) {
+            m_sites.emplace_back(protocol, std::move(typeName));
+            s = &m_sites.back();
+        }
+
+        cache.emplace(key, s);
+        return *s;
+    }
+
+    ThreadBuffer & threadBuffer() {
+        struct Lease {
+            ~Lease() {
+                if (buffer)
+                    buffer->release();
+            }
+
+            std::shared_ptr<ThreadBuffer> buffer;
+        };
+
+        thread_local Lease lease;
+        if (!lease.buffer) {
+            std::lock_guard<std::mutex> const guard(m_mutex);
+            for (const auto & buffer : m_buffers) {
+                if (buffer->acquire()) {
+                    lease.buffer = buffer;
+                    break;
+                }
+            }
+
+            if (!lease.buffer) {
+                lease.buffer = std::make_shared<ThreadBuffer>(
+                            static_cast<unsigned>(m_buffers.size()) + 1u);
+                m_buffers.push_back(lease.buffer);
+            }
+        }
+
+        return *lease.buffer;
+    }
+
+    /**
+     * \brief Writes every recorded invocation in the Chrome trace event
+     *        format, which is also understood by Perfetto.
+     */
+    void writeChromeTrace(std::ostream & os) const {
+        std::lock_guard<std::mutex> const guard(m_mutex);
+        os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        for (const auto & buffer : m_buffers) {
+            const size_t size = buffer->size();
+            for (size_t i = 0u; i < size; ++i) {
+                const Event & e = (*buffer)[i];
+                os << (first ? "\n" : ",\n")
+                   << "{\"name\":\"" << escape(e.site->protocol)
+                   << "\",\"cat\":\"" << escape(e.site->valueType)
+                   << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                   << buffer->threadId()
+                   << ",\"ts\":" << microseconds(e.start)
+                   << ",\"dur\":" << microseconds(e.duration)
+                   << ",\"args\":{\"elements\":" << e.elements << "}}";
+                first = false;
+            }
+        }
+
+        os << "\n]}\n";
+    }
+
+    /**
+     * \brief Writes a tab-separated table of the latency quantiles (in
+     *        nanoseconds) and element counts per protocol and operand type.
+     */
+    void writeSummary(std::ostream & os) const {
+        std::lock_guard<std::mutex> const guard(m_mutex);
+        os << "protocol\ttype\tinvocations\telements"
+              "\tp50\tp90\tp99\tp999\tmax\n";
+        for (const Site & s : m_sites) {
+            const Histogram & h = s.latency;
+            os << s.protocol << '\t' << s.valueType
+               << '\t' << h.count()
+               << '\t' << s.elements.load(std::memory_order_relaxed)
+               << '\t' << h.quantile(0.5)
+               << '\t' << h.quantile(0.9)
+               << '\t' << h.quantile(0.99)
+               << '\t' << h.quantile(0.999)
+               << '\t' << h.max() << '\n';
+        }
+
+        uint64_t dropped = 0u;
+        for (const auto & buffer : m_buffers)
+            dropped += buffer->dropped();
+
+        if (dropped)
+            os << "# " << dropped << " trace events dropped\n";
+    }
+
+private: /* Methods: */
+
+    Registry()
+        : m_epoch(std::chrono::steady_clock::now())
+    { }
+
+    static std::string demangle(const std::type_info & type) {
+        int status = 0;
+        char * const name =
+                abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+        if (!name)
+            return type.name();
+
+        std::string result(name);
+        std::free(name);
+        return result;
+    }
+
+    static std::string escape(const std::string & str) {
+        std::string result;
+        result.reserve(str.size());
+        for (const char c : str) {
+            if (c == '"' || c == '\\')
+                result.push_back('\\');
+            result.push_back(c);
+        }
+
+        return result;
+    }
+
+    static std::string microseconds(const uint64_t ns) {
+        std::string fraction(std::to_string(ns % 1000u));
+        fraction.insert(0u, 3u - fraction.size(), '0');
+        return std::to_string(ns / 1000u) + '.' + fraction;
+    }
+
+private: /* Fields: */
+
+    const std::chrono::steady_clock::time_point m_epoch;
+    std::atomic<bool> m_enabled{false};
+    mutable std::mutex m_mutex;
+    std::deque<Site> m_sites;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+
+}; /* class Registry { */
+
+inline uint64_t elementCount() noexcept { return 0u; }
+
+template <typename Arg, typename ... Args>
+inline uint64_t elementCount(const Arg & arg, const Args & ... args) noexcept;
+
+template <typename Arg, typename ... Args>
+inline uint64_t elementCountOf(std::false_type,
+                               const Arg &,
+                               const Args & ... args) noexcept
+{ return elementCount(args...); }
+
+template <typename Arg, typename ... Args>
+inline uint64_t elementCountOf(std::true_type,
+                               const Arg & arg,
+                               const Args & ... args) noexcept
+{ return std::max<uint64_t>(arg.size(), elementCount(args...)); }
+
+/* The element count of an invocation is the size of its largest operand. */
+template <typename Arg, typename ... Args>
+inline uint64_t elementCount(const Arg & arg, const Args & ... args) noexcept {
+    return elementCountOf(protocols_detail::IsOperand<Arg>(), arg, args...);
+}
+
+} /* namespace instrumentation { */
+#endif /* SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION */
+
+/**
+ * \brief Records the latency and size of every invocation of a protocol.
+ *
+ * InstrumentedProtocol<P>::invoke() forwards to P::invoke(). When the library
+ * is compiled with SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION defined and
+ * recording is enabled with instrumentation::Registry::setEnabled(), each
+ * invocation is added to the latency histogram of its protocol name and first
+ * operand type and to the trace buffer of the calling thread. Otherwise the
+ * wrapper only forwards, and when enabled at compile time but not at run time
+ * it costs a single relaxed atomic load per invocation.
+ *
+ * \note The protocol name is used as an identity and must have static storage
+ *       duration, e.g. be a string literal.
+ */
+template <typename Protocol>
+class __attribute__ ((visibility("internal"))) InstrumentedProtocol {
+public: /* Methods: */
+
+    template <typename ... Args>
+    InstrumentedProtocol(const char * const name, Args && ... args)
+        : m_protocol(std::forward<Args>(args)...)
+        , m_name(name)
+    { }
+
+    const char * name() const noexcept { return m_name; }
+
+    /* The return type keeps overload resolution on P::invoke() visible, e.g.
+       to AsyncProtocol. */
+    template <typename Arg, typename ... Args>
+    auto invoke(Arg && arg, Args && ... args)
+            -> decltype(std::declval<Protocol &>().invoke(
+                            std::forward<Arg>(arg),
+                            std::forward<Args>(args)...))
+    {
+#ifdef SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION
+        instrumentation::Registry & registry =
+                instrumentation::Registry::instance();
+        if (registry.enabled()) {
+            using ValueType = typename std::decay<Arg>::type;
+            instrumentation::Site & site =
+                    registry.site(m_name, typeid(ValueType));
+            const uint64_t elements =
+                    instrumentation::elementCount(arg, args...);
+
+            const uint64_t start = registry.now();
+            const bool r = m_protocol.invoke(std::forward<Arg>(arg),
+                                             std::forward<Args>(args)...);
+            const uint64_t duration = registry.now() - start;
+
+            site.latency.record(duration);
+            site.elements.fetch_add(elements, std::memory_order_relaxed);
+            registry.threadBuffer().push(
+                    instrumentation::Event{&site, start, duration, elements});
+            return r;
+        }
+#endif /* SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION */
+
+        return m_protocol.invoke(std::forward<Arg>(arg),
+                                 std::forward<Args>(args)...);
+    }
+
+private: /* Fields: */
+
+    Protocol m_protocol;
+    const char * const m_name;
+
+}; /* class InstrumentedProtocol { */
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_EMULATOR_PROTOCOLS_INSTRUMENTATION_H */
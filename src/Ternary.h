@@ -20,13 +20,69 @@
 #ifndef SHAREMIND_EMULATOR_PROTOCOLS_TERNARY_H
 #define SHAREMIND_EMULATOR_PROTOCOLS_TERNARY_H
 
+#include <climits>
 #include <type_traits>
 #include <sharemind/ShareVector.h>
 #include <sharemind/ValueTraits.h>
+#include "ConstantShareVector.h"
+#include "Detail.h"
 
 
 namespace sharemind {
 
+/**
+ * \brief Element-wise fixed-point multiply-accumulate: the result is the
+ *        third parameter plus the product of the first two.
+ *
+ * The accumulator is added to the product after truncating it by the given
+ * number of fractional bits, which yields the same value as adding it to the
+ * result of FixedPointMultiplicationProtocol.
+ */
+template <typename PDPI>
+class __attribute__ ((visibility("internal")))
+        FixedPointMultiplyAccumulateProtocol
+{
+public: /* Methods: */
+
+    FixedPointMultiplyAccumulateProtocol(PDPI & pdpi) { (void) pdpi; }
+
+    template <typename T>
+    typename std::enable_if<
+            is_any_value_tag<T>::value
+            && protocols_detail::HasIntegerElements<ShareVec<T>>::value,
+            bool>::type
+    invoke(const ShareVec<T> & param1,
+           const ShareVec<T> & param2,
+           const ShareVec<T> & param3,
+           const size_t fractional_bits,
+           ShareVec<T> & result)
+    {
+        using S = typename std::decay<decltype(result[0u])>::type;
+        using Arithmetic = protocols_detail::FixedPointArithmetic<S>;
+
+        if (param1.size() != param2.size() ||
+                param1.size() != param3.size() ||
+                param1.size() != result.size())
+        {
+            return false;
+        }
+
+        if (fractional_bits >= sizeof(S) * CHAR_BIT)
+            return false;
+
+        const unsigned f = static_cast<unsigned>(fractional_bits);
+        for (size_t i = 0u; i < param1.size(); ++i)
+            result[i] = Arithmetic::add(
+                            param3[i],
+                            Arithmetic::truncate(
+                                Arithmetic::product(param1[i], param2[i]),
+                                f));
+
+        return true;
+    }
+
+}; /* class FixedPointMultiplyAccumulateProtocol { */
+
 template <typename PDPI>
 class __attribute__ ((visibility("internal"))) ObliviousChoiceProtocol {
 public: /* Methods: */
@@ -53,6 +109,27 @@ public: /* Methods: */
         return true;
     }
 
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ConstantShareVec<U> & param1,
+           const ShareVec<T> & param2,
+           const ShareVec<T> & param3,
+           ShareVec<T> & result)
+    {
+        if (param1.size() != param2.size() ||
+                param1.size() != param3.size() ||
+                param1.size() != result.size())
+        {
+            return false;
+        }
+
+        const ShareVec<T> & chosen = param1.value() ? param2 : param3;
+        for (size_t i = 0u; i < chosen.size(); ++i)
+            result[i] = chosen[i];
+
+        return true;
+    }
+
 }; /* class ObliviousChoiceProtocol { */
 
 } /* namespace sharemind { */
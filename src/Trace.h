@@ -0,0 +1,700 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_EMULATOR_PROTOCOLS_TRACE_H
+#define SHAREMIND_EMULATOR_PROTOCOLS_TRACE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <typeindex>
+#include <utility>
+#include <vector>
+#include <sharemind/ShareVector.h>
+#include <sharemind/ValueTraits.h>
+#include <sharemind/VmVector.h>
+#include "ConstantShareVector.h"
+#include "Detail.h"
+
+
+/*
+ * Trace file format (all integers in native byte order):
+ *
+ *   file       := "SMEPTRC" 0x01 record*
+ *   record     := 0x01 u32:id u32:length byte[length]        (signature)
+ *               | 0x02 u32:signatureId u32:argc argument[argc] (invocation)
+ *   argument   := u64:size u8:hasContents [u64:length byte[length]]
+ *
+ * A signature is the protocol name followed by the codes of the argument
+ * types, e.g. "Addition:vi64,vi64,vi64". For vectors the size is the number
+ * of elements and the contents are the raw elements; public scalars have the
+ * code "pu64" and the size is the value itself. Public vectors are always
+ * recorded with their contents, share vectors only on request.
+ */
+
+namespace sharemind {
+namespace trace {
+
+constexpr char const Magic[8] = {'S', 'M', 'E', 'P', 'T', 'R', 'C', '\x01'};
+constexpr uint8_t SignatureRecord = 1u;
+constexpr uint8_t InvocationRecord = 2u;
+
+/* Upper bound on the size of vectors which are recorded without contents, so
+   that a corrupt trace can not make the replay allocate without bound. */
+constexpr uint64_t MaxSyntheticElements = uint64_t(1u) << 28u;
+
+struct __attribute__ ((visibility("internal"))) Argument {
+    uint64_t size;
+    bool hasContents;
+    std::vector<char> contents;
+};
+
+template <typename S>
+std::string elementCode() {
+    if (std::is_same<S, bool>::value)
+        return "b";
+
+    const char kind = std::is_floating_point<S>::value
+                      ? 'f'
+                      : (std::is_signed<S>::value ? 'i' : 'u');
+    return kind + std::to_string(sizeof(S) * 8u);
+}
+
+template <typename V>
+using ElementOf = typename std::decay<
+        decltype(std::declval<const V &>()[0u])>::type;
+
+/**
+ * \brief Describes how an argument type of invoke() is recorded and rebuilt.
+ *
+ * Arguments which are not recognized are recorded with the code "x" and can
+ * not be replayed. build() returns null if the recorded argument is invalid.
+ */
+template <typename A, typename = void>
+struct __attribute__ ((visibility("internal"))) ArgumentTraits {
+
+    static std::string code() { return "x"; }
+
+    static Argument record(const A &, bool)
+    { return Argument{0u, false, {}}; }
+
+};
+
+template <typename V>
+struct __attribute__ ((visibility("internal"))) ArgumentTraits<ShareVec<V>> {
+
+    using S = ElementOf<ShareVec<V>>;
+
+    static std::string code() { return 'v' + elementCode<S>(); }
+
+    static Argument record(const ShareVec<V> & vec, const bool contents) {
+        Argument arg{vec.size(), contents, {}};
+        if (contents) {
+            arg.contents.resize(vec.size() * sizeof(S));
+            for (size_t i = 0u; i < vec.size(); ++i) {
+                const S value = vec[i];
+                std::memcpy(&arg.contents[i * sizeof(S)], &value, sizeof(S));
+            }
+        }
+
+        return arg;
+    }
+
+    using Built = ShareVec<V>;
+
+    static std::unique_ptr<Built> build(const Argument & arg) {
+        if (arg.hasContents
+            ? (arg.contents.size() % sizeof(S) != 0u
+               || arg.contents.size() / sizeof(S) != arg.size)
+            : arg.size > MaxSyntheticElements)
+            return nullptr;
+
+        std::unique_ptr<Built> vec(new Built(arg.size));
+        for (size_t i = 0u; i < arg.size; ++i) {
+            S value;
+            if (arg.hasContents) {
+                std::memcpy(&value, &arg.contents[i * sizeof(S)], sizeof(S));
+            } else {
+                // Nonzero, so that Division and Remainder do not fail:
+                value = static_cast<S>(i % 127u + 1u);
+            }
+
+            (*vec)[i] = value;
+        }
+
+        return vec;
+    }
+
+};
+
+template <typename V>
+struct __attribute__ ((visibility("internal")))
+        ArgumentTraits<ConstantShareVec<V>>
+{
+
+    using S = typename ConstantShareVec<V>::share_type;
+
+    static std::string code() { return 'k' + elementCode<S>(); }
+
+    static Argument record(const ConstantShareVec<V> & vec, bool) {
+        Argument arg{vec.size(), true, std::vector<char>(sizeof(S))};
+        const S value = vec.value();
+        std::memcpy(arg.contents.data(), &value, sizeof(S));
+        return arg;
+    }
+
+    using Built = ConstantShareVec<V>;
+
+    static std::unique_ptr<Built> build(const Argument & arg) {
+        if (!arg.hasContents || arg.contents.size() != sizeof(S))
+            return nullptr;
+
+        S value;
+        std::memcpy(&value, arg.contents.data(), sizeof(S));
+        return std::unique_ptr<Built>(new Built(arg.size, value));
+    }
+
+};
+
+/* Storage for a replayed public vector, which is otherwise a view of VM
+   memory. The storage base is initialized before the view. */
+template <typename S>
+struct __attribute__ ((visibility("internal"))) VmVecStorage {
+    std::vector<S> data;
+};
+
+template <typename V>
+class __attribute__ ((visibility("internal"))) OwningImmutableVmVec
+        : private VmVecStorage<ElementOf<ImmutableVmVec<V>>>
+        , public ImmutableVmVec<V>
+{
+
+public: /* Types: */
+
+    using S = ElementOf<ImmutableVmVec<V>>;
+
+public: /* Methods: */
+
+    explicit OwningImmutableVmVec(std::vector<S> data)
+        : VmVecStorage<S>{std::move(data)}
+        , ImmutableVmVec<V>(reference(this->data))
+    { }
+
+private: /* Methods: */
+
+    static SharemindModuleApi0x1CReference reference(
+            const std::vector<S> & data)
+    {
+        SharemindModuleApi0x1CReference ref = {};
+        ref.pData = data.data();
+        ref.size = data.size() * sizeof(S);
+        return ref;
+    }
+
+};
+
+/* Public vectors are small and not secret, so their contents are always
+   recorded; e.g. segment offsets determine the work of an invocation. */
+template <typename V>
+struct __attribute__ ((visibility("internal")))
+        ArgumentTraits<ImmutableVmVec<V>>
+{
+
+    using S = ElementOf<ImmutableVmVec<V>>;
+    using Built = OwningImmutableVmVec<V>;
+
+    static std::string code() { return 'm' + elementCode<S>(); }
+
+    static Argument record(const ImmutableVmVec<V> & vec, bool) {
+        Argument arg{vec.size(), true, {}};
+        arg.contents.resize(vec.size() * sizeof(S));
+        for (size_t i = 0u; i < vec.size(); ++i) {
+            const S value = vec[i];
+            std::memcpy(&arg.contents[i * sizeof(S)], &value, sizeof(S));
+        }
+
+        return arg;
+    }
+
+    static std::unique_ptr<Built> build(const Argument & arg) {
+        if (!arg.hasContents
+            || arg.contents.size() % sizeof(S) != 0u
+            || arg.contents.size() / sizeof(S) != arg.size)
+            return nullptr;
+
+        std::vector<S> data(arg.size);
+        if (!data.empty())
+            std::memcpy(data.data(), arg.contents.data(), arg.contents.size());
+
+        return std::unique_ptr<Built>(new Built(std::move(data)));
+    }
+
+};
+
+/* Public scalars are recorded as 64-bit unsigned integers whatever their
+   type, so that the signature does not depend on the type of the literal
+   passed by the caller, e.g. 16u or a size_t. */
+template <typename A>
+struct __attribute__ ((visibility("internal"))) ArgumentTraits<
+        A,
+        typename std::enable_if<std::is_integral<A>::value>::type>
+{
+
+    static std::string code() { return 'p' + elementCode<uint64_t>(); }
+
+    static Argument record(const A & value, bool)
+    { return Argument{static_cast<uint64_t>(value), false, {}}; }
+
+    using Built = A;
+
+    static std::unique_ptr<Built> build(const Argument & arg)
+    { return std::unique_ptr<Built>(new Built(static_cast<A>(arg.size))); }
+
+};
+
+template <typename ... Args>
+std::string signatureOf(const char * const protocol) {
+    const std::string codes[] = { std::string(),
+                                  ArgumentTraits<Args>::code()... };
+    std::string signature(protocol);
+    signature.push_back(':');
+    for (size_t i = 1u; i < sizeof(codes) / sizeof(codes[0u]); ++i) {
+        if (i > 1u)
+            signature.push_back(',');
+        signature += codes[i];
+    }
+
+    return signature;
+}
+
+/**
+ * \brief Writes protocol invocations to a trace file.
+ *
+ * The contents of the input share vectors are only written when requested,
+ * as they make the trace as large as the data. Which operands are inputs is
+ * determined from the signature of Protocol::invoke(), see IsInputOperand.
+ * Recording is serialized, so a writer may be shared between threads.
+ */
+class __attribute__ ((visibility("internal"))) TraceWriter {
+
+public: /* Methods: */
+
+    TraceWriter(std::ostream & os, const bool recordContents = false)
+        : m_os(os)
+        , m_recordContents(recordContents)
+    { m_os.write(Magic, sizeof(Magic)); }
+
+    template <typename Protocol, typename ... Args>
+    void record(const char * const protocol, Args & ... args) {
+        using Indices = typename protocols_detail::MakeIndexSequence<
+                sizeof...(Args)>::type;
+        record<Protocol>(protocol, Indices(), args...);
+    }
+
+private: /* Methods: */
+
+    template <typename Protocol, typename ... Args, std::size_t ... Is>
+    void record(const char * const protocol,
+                protocols_detail::IndexSequence<Is...>,
+                Args & ... args)
+    {
+        const Argument recorded[] = {
+            Argument{0u, false, {}},
+            ArgumentTraits<typename std::remove_const<Args>::type>::record(
+                args,
+                m_recordContents
+                && protocols_detail::IsInputOperand<Protocol, Is, Args...>
+                        ::value)...
+        };
+
+        const std::type_index type(
+                typeid(std::tuple<typename std::decay<Args>::type...>));
+
+        std::lock_guard<std::mutex> const guard(m_mutex);
+        uint32_t & id = m_signatures[std::make_pair(
+                            static_cast<const void *>(protocol), type)];
+        if (id == 0u) {
+            id = static_cast<uint32_t>(m_signatures.size());
+            const std::string signature(
+                    signatureOf<typename std::decay<Args>::type...>(protocol));
+            writeValue(SignatureRecord);
+            writeValue(id);
+            writeValue(static_cast<uint32_t>(signature.size()));
+            m_os.write(signature.data(),
+                       static_cast<std::streamsize>(signature.size()));
+        }
+
+        writeValue(InvocationRecord);
+        writeValue(id);
+        writeValue(static_cast<uint32_t>(sizeof...(Args)));
+        for (size_t i = 1u; i <= sizeof...(Args); ++i) {
+            const Argument & arg = recorded[i];
+            writeValue(arg.size);
+            writeValue(static_cast<uint8_t>(arg.hasContents));
+            if (arg.hasContents) {
+                writeValue(static_cast<uint64_t>(arg.contents.size()));
+                m_os.write(arg.contents.data(),
+                           static_cast<std::streamsize>(arg.contents.size()));
+            }
+        }
+    }
+
+    template <typename T>
+    void writeValue(const T value) {
+        m_os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+private: /* Fields: */
+
+    std::ostream & m_os;
+    const bool m_recordContents;
+    std::mutex m_mutex;
+    std::map<std::pair<const void *, std::type_index>, uint32_t> m_signatures;
+
+}; /* class TraceWriter { */
+
+/**
+ * \brief Re-executes the invocations of a trace file against the protocols
+ *        registered with add(), and measures the time spent in them.
+ */
+class __attribute__ ((visibility("internal"))) TraceReplayer {
+
+private: /* Types: */
+
+    using Invoker = std::function<bool (const std::vector<Argument> &,
+                                        bool & valid,
+                                        uint64_t & elements,
+                                        std::chrono::nanoseconds & time)>;
+
+    struct Statistics {
+        uint64_t invocations = 0u;
+        uint64_t failures = 0u;
+        uint64_t elements = 0u;
+        std::chrono::nanoseconds time{0};
+    };
+
+public: /* Methods: */
+
+    /**
+     * \brief Registers a protocol instance for the invocations of the given
+     *        name and argument types, e.g.
+     *        add<ShareVec<V>, ShareVec<V>, ShareVec<V>>("Addition", p).
+     */
+    template <typename ... Args, typename Protocol>
+    void add(const char * const protocol, Protocol & p) {
+        using Indices = typename protocols_detail::MakeIndexSequence<
+                sizeof...(Args)>::type;
+        m_invokers[signatureOf<Args...>(protocol)] =
+                [&p](const std::vector<Argument> & args,
+                     bool & valid,
+                     uint64_t & elements,
+                     std::chrono::nanoseconds & time)
+                {
+                    return invoke<Args...>(p,
+                                           args,
+                                           valid,
+                                           elements,
+                                           time,
+                                           Indices());
+                };
+    }
+
+    /**
+     * \returns false if the trace is malformed, e.g. truncated, or with
+     *          sizes which exceed the trace or MaxSyntheticElements, or if
+     *          it does not fit into memory.
+     */
+    bool replay(std::istream & is) {
+        try {
+            return replayRecords(is);
+        } catch (const std::bad_alloc &) {
+            return false;
+        }
+    }
+
+    /** \brief Writes a tab-separated table of the replayed invocations. */
+    void writeReport(std::ostream & os) const {
+        os << "signature\tinvocations\tfailures\telements"
+              "\ttotal_us\tmean_us\n";
+        for (const auto & p : m_statistics) {
+            const Statistics & s = p.second;
+            const double total = s.time.count() / 1000.0;
+            os << p.first
+               << '\t' << s.invocations
+               << '\t' << s.failures
+               << '\t' << s.elements
+               << '\t' << total
+               << '\t' << (s.invocations ? total / s.invocations : 0.0)
+               << '\n';
+        }
+
+        for (const auto & p : m_skipped)
+            os << "# " << p.second << " invocations of unregistered "
+               << p.first << " skipped\n";
+    }
+
+private: /* Methods: */
+
+    bool replayRecords(std::istream & is) {
+        char magic[sizeof(Magic)];
+        if (!is.read(magic, sizeof(magic))
+            || std::memcmp(magic, Magic, sizeof(Magic)) != 0)
+            return false;
+
+        uint64_t remaining = streamSize(is);
+
+        std::map<uint32_t, std::string> signatures;
+        std::vector<Argument> args;
+        uint8_t tag;
+        while (readValue(is, remaining, tag)) {
+            uint32_t id;
+            if (!readValue(is, remaining, id))
+                return false;
+
+            if (tag == SignatureRecord) {
+                uint32_t length;
+                if (!readValue(is, remaining, length) || length > remaining)
+                    return false;
+
+                std::string signature;
+                if (!readBlob(is, remaining, signature, length))
+                    return false;
+
+                signatures[id] = std::move(signature);
+                continue;
+            }
+
+            /* Every argument takes at least a size and a contents flag. */
+            uint32_t argc;
+            if (tag != InvocationRecord
+                || !readValue(is, remaining, argc)
+                || argc > remaining / (sizeof(uint64_t) + sizeof(uint8_t)))
+                return false;
+
+            args.clear();
+            for (uint32_t i = 0u; i < argc; ++i) {
+                args.emplace_back();
+                Argument & arg = args.back();
+                uint8_t hasContents;
+                if (!readValue(is, remaining, arg.size)
+                    || !readValue(is, remaining, hasContents))
+                    return false;
+
+                arg.hasContents = hasContents;
+                if (hasContents) {
+                    uint64_t length;
+                    if (!readValue(is, remaining, length)
+                        || length > remaining)
+                        return false;
+
+                    if (!readBlob(is, remaining, arg.contents, length))
+                        return false;
+                }
+            }
+
+            const auto signature = signatures.find(id);
+            if (signature == signatures.end())
+                return false;
+
+            const auto invoker = m_invokers.find(signature->second);
+            if (invoker == m_invokers.end()) {
+                ++m_skipped[signature->second];
+                continue;
+            }
+
+            bool valid = true;
+            uint64_t elements = 0u;
+            std::chrono::nanoseconds time(0);
+            const bool result =
+                    invoker->second(args, valid, elements, time);
+
+            if (!valid)
+                return false;
+
+            Statistics & stats = m_statistics[signature->second];
+            if (!result)
+                ++stats.failures;
+
+            ++stats.invocations;
+            stats.elements += elements;
+            stats.time += time;
+        }
+
+        return is.eof();
+    }
+
+    /* Counts the bytes read off the remaining size, as tellg() fails on
+       pipes. */
+    static bool readBytes(std::istream & is,
+                          uint64_t & remaining,
+                          char * const data,
+                          const uint64_t size)
+    {
+        if (!is.read(data, static_cast<std::streamsize>(size)))
+            return false;
+
+        remaining -= std::min(remaining, size);
+        return true;
+    }
+
+    /* Reads in chunks, so that memory is only allocated for data which is
+       actually in the stream. */
+    template <typename Container>
+    static bool readBlob(std::istream & is,
+                         uint64_t & remaining,
+                         Container & blob,
+                         uint64_t length)
+    {
+        constexpr uint64_t chunkSize = uint64_t(1u) << 20u;
+        blob.clear();
+        while (length) {
+            const uint64_t chunk = std::min(length, chunkSize);
+            const std::size_t offset = blob.size();
+            blob.resize(offset + chunk);
+            if (!readBytes(is, remaining, &blob[offset], chunk))
+                return false;
+
+            length -= chunk;
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    static bool readValue(std::istream & is, uint64_t & remaining, T & value) {
+        return readBytes(is,
+                         remaining,
+                         reinterpret_cast<char *>(&value),
+                         sizeof(value));
+    }
+
+    /* The size of the rest of a seekable stream, or a bound on the trace size
+       otherwise. */
+    static uint64_t streamSize(std::istream & is) {
+        constexpr uint64_t maxTraceSize = uint64_t(1u) << 40u;
+        const std::streamoff position = is.tellg();
+        if (position < 0 || !is.seekg(0, std::ios_base::end)) {
+            is.clear();
+            return maxTraceSize;
+        }
+
+        const std::streamoff end = is.tellg();
+        is.seekg(position);
+        return end < position ? 0u : static_cast<uint64_t>(end - position);
+    }
+
+    template <typename ... Args, typename Protocol, std::size_t ... Is>
+    static bool invoke(Protocol & p,
+                       const std::vector<Argument> & args,
+                       bool & valid,
+                       uint64_t & elements,
+                       std::chrono::nanoseconds & time,
+                       protocols_detail::IndexSequence<Is...>)
+    {
+        valid = false;
+        if (args.size() != sizeof...(Args))
+            return false;
+
+        const std::tuple<std::unique_ptr<typename ArgumentTraits<Args>::Built>
+                         ...> built(ArgumentTraits<Args>::build(args[Is])...);
+        const bool builtAll[] = {
+            true,
+            static_cast<bool>(std::get<Is>(built))...
+        };
+        for (const bool b : builtAll)
+            if (!b)
+                return false;
+
+        valid = true;
+
+        const uint64_t sizes[] = {
+            0u,
+            (protocols_detail::IsOperand<Args>::value ? args[Is].size : 0u)...
+        };
+        for (const uint64_t size : sizes)
+            elements = std::max(elements, size);
+
+        const auto start = std::chrono::steady_clock::now();
+        const bool r = p.invoke(*std::get<Is>(built)...);
+        time = std::chrono::steady_clock::now() - start;
+        return r;
+    }
+
+private: /* Fields: */
+
+    std::map<std::string, Invoker> m_invokers;
+    std::map<std::string, Statistics> m_statistics;
+    std::map<std::string, uint64_t> m_skipped;
+
+}; /* class TraceReplayer { */
+
+} /* namespace trace { */
+
+/**
+ * \brief Writes every invocation of a protocol to a trace before forwarding
+ *        it to the protocol.
+ *
+ * \note The protocol name must have static storage duration, e.g. be a
+ *       string literal.
+ */
+template <typename Protocol>
+class __attribute__ ((visibility("internal"))) RecordingProtocol {
+public: /* Methods: */
+
+    template <typename ... Args>
+    RecordingProtocol(const char * const name,
+                      trace::TraceWriter & writer,
+                      Args && ... args)
+        : m_protocol(std::forward<Args>(args)...)
+        , m_name(name)
+        , m_writer(writer)
+    { }
+
+    template <typename ... Args>
+    auto invoke(Args && ... args)
+            -> decltype(std::declval<Protocol &>().invoke(
+                            std::forward<Args>(args)...))
+    {
+        m_writer.template record<Protocol>(m_name, args...);
+        return m_protocol.invoke(std::forward<Args>(args)...);
+    }
+
+private: /* Fields: */
+
+    Protocol m_protocol;
+    const char * const m_name;
+    trace::TraceWriter & m_writer;
+
+}; /* class RecordingProtocol { */
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_EMULATOR_PROTOCOLS_TRACE_H */
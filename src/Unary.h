@@ -21,13 +21,132 @@
 #define SHAREMIND_EMULATOR_PROTOCOLS_UNARY_H
 
 #include <algorithm>
+#include <limits>
 #include <type_traits>
+#include <utility>
 #include <sharemind/ShareVector.h>
 #include <sharemind/ValueTraits.h>
+#include <sharemind/VmVector.h>
+#include "ConstantShareVector.h"
+#include "Detail.h"
 
 
 namespace sharemind {
 
+enum MinimumMaximumMode { /// \todo
+    ModeMin,
+    ModeMax
+};
+
+/**
+ * \brief Finds the positions of the minima or maxima of equal-length
+ *        segments, optionally together with the values.
+ *
+ * Like MinimumMaximumProtocol, the parameter is split into result.size()
+ * segments of equal length. The index of each extremum is relative to the
+ * start of its segment. If the extremum occurs several times in a segment,
+ * the smallest index is returned. The protocol fails if the segments are
+ * longer than the index type can address.
+ */
+template <typename PDPI, MinimumMaximumMode mode>
+class __attribute__ ((visibility("internal"))) ArgMinimumMaximumProtocol {
+public: /* Methods: */
+
+    ArgMinimumMaximumProtocol(PDPI & pdpi) { (void) pdpi; }
+
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param,
+           ShareVec<U> & indices)
+    {
+        const size_t result_size = indices.size();
+
+        if (result_size == 0u)
+            return false;
+
+        if (param.size() % result_size != 0u)
+            return false;
+
+        const size_t subarr_len = param.size() / result_size;
+
+        if (subarr_len == 0u || !indexFits(indices, subarr_len - 1u))
+            return false;
+
+        for (size_t i = 0u; i < result_size; ++i)
+            indices[i] = findExtremum(param, i * subarr_len, subarr_len).second;
+
+        return true;
+    }
+
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ShareVec<T> & param,
+           ShareVec<T> & values,
+           ShareVec<U> & indices)
+    {
+        const size_t result_size = indices.size();
+
+        if (result_size == 0u || values.size() != result_size)
+            return false;
+
+        if (param.size() % result_size != 0u)
+            return false;
+
+        const size_t subarr_len = param.size() / result_size;
+
+        if (subarr_len == 0u || !indexFits(indices, subarr_len - 1u))
+            return false;
+
+        for (size_t i = 0u; i < result_size; ++i) {
+            const auto extremum =
+                    findExtremum(param, i * subarr_len, subarr_len);
+            values[i] = extremum.first;
+            indices[i] = extremum.second;
+        }
+
+        return true;
+    }
+
+private: /* Methods: */
+
+    template <typename U>
+    static bool indexFits(const ShareVec<U> & indices, const size_t index) {
+        using I = typename std::decay<decltype(indices[0u])>::type;
+        constexpr int digits = std::numeric_limits<I>::digits;
+        static_assert(digits > 0
+                      && digits <= std::numeric_limits<size_t>::digits,
+                      "Unsupported index type!");
+        // Two shifts, as shifting by the full width is undefined:
+        return ((index >> (digits - 1)) >> 1u) == 0u;
+    }
+
+    /* Strict comparisons keep the first occurrence of the extremum. */
+    template <typename T>
+    static auto findExtremum(const ShareVec<T> & param,
+                             const size_t offset,
+                             const size_t length)
+            -> std::pair<typename std::decay<decltype(param[0u])>::type,
+                         size_t>
+    {
+        using S = typename std::decay<decltype(param[0u])>::type;
+
+        S extremum = param[offset];
+        size_t index = 0u;
+        for (size_t j = 1u; j < length; ++j) {
+            const S value = param[offset + j];
+            const bool better =
+                    mode == ModeMin ? value < extremum : value > extremum;
+            if (better) {
+                extremum = value;
+                index = j;
+            }
+        }
+
+        return std::make_pair(extremum, index);
+    }
+
+}; /* class ArgMinimumMaximumProtocol { */
+
 template <typename PDPI>
 class __attribute__ ((visibility("internal"))) BitwiseInvProtocol {
 public: /* Methods: */
@@ -72,11 +191,6 @@ public: /* Methods: */
 
 }; /* class ConversionProtocol { */
 
-enum MinimumMaximumMode { /// \todo
-    ModeMin,
-    ModeMax
-};
-
 template <typename PDPI, MinimumMaximumMode mode>
 class __attribute__ ((visibility("internal"))) MinimumMaximumProtocol {
 public: /* Methods: */
@@ -113,6 +227,75 @@ public: /* Methods: */
         return true;
     }
 
+    /**
+     * Segmented variant: the i-th result is the extremum of the elements of
+     * param from offsets[i] up to but not including offsets[i + 1]. Empty
+     * segments are not allowed. Large inputs are reduced on several threads,
+     * see protocols_detail::forEachSegmentRange().
+     */
+    template <typename T, typename O>
+    typename std::enable_if<is_any_value_tag<T>::value
+                            && is_any_value_tag<O>::value, bool>::type
+    invoke(const ShareVec<T> & param,
+           const ImmutableVmVec<O> & offsets,
+           ShareVec<T> & result)
+    {
+        using S = typename std::decay<decltype(result[0u])>::type;
+
+        const size_t result_size = result.size();
+
+        if (!protocols_detail::validSegmentOffsets(offsets,
+                                                   param.size(),
+                                                   result_size,
+                                                   false))
+            return false;
+
+        protocols_detail::forEachSegmentRange(
+                offsets,
+                result_size,
+                [&param, &offsets, &result](const size_t first,
+                                            const size_t last)
+                {
+                    for (size_t i = first; i < last; ++i) {
+                        const size_t begin = offsets[i];
+                        const size_t end = offsets[i + 1u];
+                        S extremum = param[begin];
+                        for (size_t j = begin + 1u; j < end; ++j) {
+                            const S value = param[j];
+                            if (mode == ModeMin) {
+                                extremum = value < extremum ? value : extremum;
+                            } else {
+                                extremum = value > extremum ? value : extremum;
+                            }
+                        }
+
+                        result[i] = extremum;
+                    }
+                });
+
+        return true;
+    }
+
+    template <typename T>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ConstantShareVec<T> & param,
+           ShareVec<T> & result)
+    {
+        const size_t result_size = result.size();
+
+        if (result_size == 0u)
+            return false;
+
+        // Like the segmented variant, empty segments have no extremum:
+        if (param.size() == 0u || param.size() % result_size != 0u)
+            return false;
+
+        for (size_t i = 0u; i < result_size; ++i)
+            result[i] = param.value();
+
+        return true;
+    }
+
 }; /* class MinimumMaximumProtocol { */
 
 template <typename PDPI>
@@ -197,6 +380,77 @@ public: /* Methods: */
         return true;
     }
 
+    /**
+     * Segmented variant: the i-th result is the product of the elements of
+     * param from offsets[i] up to but not including offsets[i + 1]. The
+     * product of an empty segment is 1. Threads are used as for Sum.
+     */
+    template <typename T, typename O, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value
+                            && is_any_value_tag<O>::value, bool>::type
+    invoke(const ShareVec<T> & param,
+           const ImmutableVmVec<O> & offsets,
+           ShareVec<U> & result)
+    {
+        using S = typename std::decay<decltype(result[0u])>::type;
+
+        const size_t result_size = result.size ();
+
+        if (!protocols_detail::validSegmentOffsets(offsets,
+                                                   param.size(),
+                                                   result_size))
+            return false;
+
+        protocols_detail::forEachSegmentRange(
+                offsets,
+                result_size,
+                [&param, &offsets, &result](const size_t first,
+                                            const size_t last)
+                {
+                    for (size_t i = first; i < last; ++i) {
+                        const size_t end = offsets[i + 1u];
+                        S product = 1;
+                        for (size_t j = offsets[i]; j < end; ++j)
+                            product *= param[j];
+
+                        result[i] = product;
+                    }
+                });
+
+        return true;
+    }
+
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ConstantShareVec<T> & param,
+           ShareVec<U> & result)
+    {
+        using S = typename std::decay<decltype(result[0u])>::type;
+
+        const size_t param_size = param.size ();
+        const size_t result_size = result.size ();
+        if (result_size == 0u)
+            return false;
+
+        if (param_size == 0u) {
+            if (result_size != 1)
+                return false;
+            result[0] = 0;
+            return true;
+        }
+
+        if (param_size % result_size != 0u)
+            return false;
+
+        const S product = protocols_detail::repeatedProduct<S>(
+                param.value(), param_size / result_size);
+        for (size_t i = 0u; i < result_size; ++i) {
+            result[i] = product;
+        }
+
+        return true;
+    }
+
 }; /* class ProductProtocol { */
 
 template <typename PDPI>
@@ -252,6 +506,71 @@ public: /* Methods: */
         return true;
     }
 
+    /**
+     * Segmented variant: the i-th result is the sum of the elements of param
+     * from offsets[i] up to but not including offsets[i + 1]. Large inputs
+     * are split between threads into ranges of segments with similar element
+     * counts, see protocols_detail::forEachSegmentRange().
+     */
+    template <typename T, typename O, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value
+                            && is_any_value_tag<O>::value, bool>::type
+    invoke(const ShareVec<T> & param,
+           const ImmutableVmVec<O> & offsets,
+           ShareVec<U> & result)
+    {
+        using S = typename std::decay<decltype(result[0u])>::type;
+
+        const size_t result_size = result.size ();
+
+        if (!protocols_detail::validSegmentOffsets(offsets,
+                                                   param.size(),
+                                                   result_size))
+            return false;
+
+        protocols_detail::forEachSegmentRange(
+                offsets,
+                result_size,
+                [&param, &offsets, &result](const size_t first,
+                                            const size_t last)
+                {
+                    for (size_t i = first; i < last; ++i) {
+                        const size_t end = offsets[i + 1u];
+                        S sum = 0;
+                        for (size_t j = offsets[i]; j < end; ++j)
+                            sum += param[j];
+
+                        result[i] = sum;
+                    }
+                });
+
+        return true;
+    }
+
+    template <typename T, typename U>
+    typename std::enable_if<is_any_value_tag<T>::value, bool>::type
+    invoke(const ConstantShareVec<T> & param,
+           ShareVec<U> & result)
+    {
+        using S = typename std::decay<decltype(result[0u])>::type;
+
+        const size_t param_size = param.size ();
+        const size_t result_size = result.size ();
+        if (result_size == 0u)
+            return false;
+
+        if (param_size % result_size != 0u)
+            return false;
+
+        const S sum = protocols_detail::repeatedSum<S>(
+                param.value(), param_size / result_size);
+        for (size_t i = 0u; i < result_size; ++i) {
+            result[i] = sum;
+        }
+
+        return true;
+    }
+
 }; /* class SumProtocol { */
 
 } /* namespace sharemind { */
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+/*
+ * Replays a protocol trace written by RecordingProtocol against the protocols
+ * of this library and reports the time spent per protocol and signature.
+ *
+ * The protocols are registered under their class names without the
+ * "Protocol" suffix ("Min" and "Max" for MinimumMaximumProtocol and "ArgMin"
+ * and "ArgMax" for ArgMinimumMaximumProtocol), which are the names the
+ * recording side is expected to use.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sharemind/ShareVector.h>
+#include <sharemind/ValueTraits.h>
+#include <sharemind/VmVector.h>
+#include "Binary.h"
+#include "Ternary.h"
+#include "Trace.h"
+#include "Unary.h"
+
+
+namespace {
+
+using namespace sharemind;
+
+/* None of the replayed protocols use the PDPI. */
+struct MockPdpi {};
+
+template <typename S>
+struct ReplayValue: public any_value_tag {
+    using share_type = S;
+    using public_type = S;
+    static constexpr size_t num_of_bits = sizeof(S) * 8u;
+};
+
+struct Protocols {
+
+    Protocols(MockPdpi & pdpi)
+        : addition(pdpi), bitwiseAnd(pdpi), bitwiseOr(pdpi), bitwiseXor(pdpi)
+        , division(pdpi), equality(pdpi), fixedPointDotProduct(pdpi)
+        , fixedPointMultiplication(pdpi), greaterThan(pdpi)
+        , greaterThanOrEqual(pdpi), lessThan(pdpi), lessThanOrEqual(pdpi)
+        , maximum(pdpi), minimum(pdpi), multiplication(pdpi), remainder(pdpi)
+        , subtraction(pdpi), bitwiseInv(pdpi), min(pdpi), max(pdpi), neg(pdpi)
+        , product(pdpi), sign(pdpi), sum(pdpi), argMin(pdpi), argMax(pdpi)
+        , fixedPointMultiplyAccumulate(pdpi), obliviousChoice(pdpi)
+    { }
+
+    AdditionProtocol<MockPdpi> addition;
+    BitwiseAndProtocol<MockPdpi> bitwiseAnd;
+    BitwiseOrProtocol<MockPdpi> bitwiseOr;
+    BitwiseXorProtocol<MockPdpi> bitwiseXor;
+    DivisionProtocol<MockPdpi> division;
+    EqualityProtocol<MockPdpi> equality;
+    FixedPointDotProductProtocol<MockPdpi> fixedPointDotProduct;
+    FixedPointMultiplicationProtocol<MockPdpi> fixedPointMultiplication;
+    GreaterThanProtocol<MockPdpi> greaterThan;
+    GreaterThanOrEqualProtocol<MockPdpi> greaterThanOrEqual;
+    LessThanProtocol<MockPdpi> lessThan;
+    LessThanOrEqualProtocol<MockPdpi> lessThanOrEqual;
+    MaximumProtocol<MockPdpi> maximum;
+    MinimumProtocol<MockPdpi> minimum;
+    MultiplicationProtocol<MockPdpi> multiplication;
+    RemainderProtocol<MockPdpi> remainder;
+    SubtractionProtocol<MockPdpi> subtraction;
+    BitwiseInvProtocol<MockPdpi> bitwiseInv;
+    MinimumMaximumProtocol<MockPdpi, ModeMin> min;
+    MinimumMaximumProtocol<MockPdpi, ModeMax> max;
+    NegProtocol<MockPdpi> neg;
+    ProductProtocol<MockPdpi> product;
+    SignProtocol<MockPdpi> sign;
+    SumProtocol<MockPdpi> sum;
+    ArgMinimumMaximumProtocol<MockPdpi, ModeMin> argMin;
+    ArgMinimumMaximumProtocol<MockPdpi, ModeMax> argMax;
+    FixedPointMultiplyAccumulateProtocol<MockPdpi>
+            fixedPointMultiplyAccumulate;
+    ObliviousChoiceProtocol<MockPdpi> obliviousChoice;
+
+};
+
+template <typename S>
+void addProtocols(trace::TraceReplayer & r, Protocols & p) {
+    using V = ShareVec<ReplayValue<S>>;
+    using B = ShareVec<ReplayValue<bool>>;
+    using C = ConstantShareVec<ReplayValue<S>>;
+    using M = ImmutableVmVec<ReplayValue<S>>;
+    using I = ShareVec<ReplayValue<uint64_t>>;
+    using O = ImmutableVmVec<ReplayValue<uint64_t>>;
+
+    r.add<V, V, V>("Addition", p.addition);
+    r.add<V, C, V>("Addition", p.addition);
+    r.add<V, V, V>("BitwiseAnd", p.bitwiseAnd);
+    r.add<V, C, V>("BitwiseAnd", p.bitwiseAnd);
+    r.add<V, V, V>("BitwiseOr", p.bitwiseOr);
+    r.add<V, C, V>("BitwiseOr", p.bitwiseOr);
+    r.add<V, V, V>("BitwiseXor", p.bitwiseXor);
+    r.add<V, C, V>("BitwiseXor", p.bitwiseXor);
+    r.add<V, V, V>("Division", p.division);
+    r.add<V, C, V>("Division", p.division);
+    r.add<V, M, V>("Division", p.division);
+    r.add<V, V, B>("Equality", p.equality);
+    r.add<V, C, B>("Equality", p.equality);
+    r.add<V, V, size_t, V>("FixedPointDotProduct", p.fixedPointDotProduct);
+    r.add<V, V, size_t, V>("FixedPointMultiplication",
+                           p.fixedPointMultiplication);
+    r.add<V, V, B>("GreaterThan", p.greaterThan);
+    r.add<V, C, B>("GreaterThan", p.greaterThan);
+    r.add<V, V, B>("GreaterThanOrEqual", p.greaterThanOrEqual);
+    r.add<V, C, B>("GreaterThanOrEqual", p.greaterThanOrEqual);
+    r.add<V, V, B>("LessThan", p.lessThan);
+    r.add<V, C, B>("LessThan", p.lessThan);
+    r.add<V, V, B>("LessThanOrEqual", p.lessThanOrEqual);
+    r.add<V, C, B>("LessThanOrEqual", p.lessThanOrEqual);
+    r.add<V, V, V>("Maximum", p.maximum);
+    r.add<V, V, V>("Minimum", p.minimum);
+    r.add<V, V, V>("Multiplication", p.multiplication);
+    r.add<V, C, V>("Multiplication", p.multiplication);
+    r.add<V, M, V>("Multiplication", p.multiplication);
+    r.add<V, V, V>("Remainder", p.remainder);
+    r.add<V, C, V>("Remainder", p.remainder);
+    r.add<V, M, V>("Remainder", p.remainder);
+    r.add<V, V, V>("Subtraction", p.subtraction);
+    r.add<V, C, V>("Subtraction", p.subtraction);
+    r.add<C, V, V>("Subtraction", p.subtraction);
+
+    r.add<V, V>("BitwiseInv", p.bitwiseInv);
+    r.add<V, V>("Min", p.min);
+    r.add<C, V>("Min", p.min);
+    r.add<V, O, V>("Min", p.min);
+    r.add<V, V>("Max", p.max);
+    r.add<C, V>("Max", p.max);
+    r.add<V, O, V>("Max", p.max);
+    r.add<V, V>("Neg", p.neg);
+    r.add<V, V>("Product", p.product);
+    r.add<C, V>("Product", p.product);
+    r.add<V, O, V>("Product", p.product);
+    r.add<V, V>("Sign", p.sign);
+    r.add<V, V>("Sum", p.sum);
+    r.add<C, V>("Sum", p.sum);
+    r.add<V, O, V>("Sum", p.sum);
+
+    r.add<V, I>("ArgMin", p.argMin);
+    r.add<V, V>("ArgMin", p.argMin);
+    r.add<V, V, I>("ArgMin", p.argMin);
+    r.add<V, V, V>("ArgMin", p.argMin);
+    r.add<V, I>("ArgMax", p.argMax);
+    r.add<V, V>("ArgMax", p.argMax);
+    r.add<V, V, I>("ArgMax", p.argMax);
+    r.add<V, V, V>("ArgMax", p.argMax);
+
+    r.add<V, V, V, size_t, V>("FixedPointMultiplyAccumulate",
+                              p.fixedPointMultiplyAccumulate);
+    r.add<B, V, V, V>("ObliviousChoice", p.obliviousChoice);
+}
+
+} /* namespace { */
+
+int main(int argc, char * argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <trace file>" << std::endl;
+        return 2;
+    }
+
+    std::ifstream is(argv[1], std::ios::binary);
+    if (!is) {
+        std::cerr << "Failed to open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    MockPdpi pdpi;
+    Protocols protocols(pdpi);
+    trace::TraceReplayer replayer;
+    addProtocols<int8_t>(replayer, protocols);
+    addProtocols<int16_t>(replayer, protocols);
+    addProtocols<int32_t>(replayer, protocols);
+    addProtocols<int64_t>(replayer, protocols);
+    addProtocols<uint8_t>(replayer, protocols);
+    addProtocols<uint16_t>(replayer, protocols);
+    addProtocols<uint32_t>(replayer, protocols);
+    addProtocols<uint64_t>(replayer, protocols);
+
+    const bool ok = replayer.replay(is);
+    replayer.writeReport(std::cout);
+    if (!ok) {
+        std::cerr << "Malformed trace " << argv[1] << std::endl;
+        return 1;
+    }
+
+    return 0;
+}